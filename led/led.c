@@ -1,100 +1,281 @@
-
-
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/ioport.h>
 #include <linux/platform_device.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
 #include <asm/io.h>
 #include <asm/errno.h>
 
+#include "led_jitter.h"
+
 MODULE_LICENSE("Dual BSD/GPL");
 
-unsigned long LED_CTRL_REG = 0x4805113c;
-unsigned long LED_OE_REG = 0x48051134;
-static unsigned LED_CTRL_OFFSET = 0x13c;
-int LED_CNTRL_BIT = 14;
+#define LED_CTRL_REG 0x4805113c
+#define LED_OE_REG 0x48051134
+
+// Register offsets within the mapped window, which starts at LED_OE_REG
+#define LED_OE_OFFSET 0
+#define LED_CTRL_OFFSET (LED_CTRL_REG - LED_OE_REG)
+
+#define LED_DEFAULT_PERIOD_NS 1000000000
+
+/*
+ * Expire the timer in hard interrupt context also on PREEMPT_RT, otherwise
+ * the edges would be produced by the softirq thread.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+#define LED_HRTIMER_MODE HRTIMER_MODE_REL_HARD
+#else
+#define LED_HRTIMER_MODE HRTIMER_MODE_REL
+#endif
+
+struct led_context {
+	void __iomem* base;
+	struct miscdevice misc;
+	struct hrtimer timer;
+	raw_spinlock_t lock;
+	ktime_t period;
+	u32 led_figure;
+	atomic_t in_use;
+	struct led_jitter_hist jitter;
+};
+
+static struct resource led_resource = {
+	.start = LED_OE_REG,
+	.end = LED_CTRL_REG + 3,
+	.flags = IORESOURCE_MEM,
+	.name = "USER2_LED",
+};
+
+static struct platform_device* led_pdev;
+
+
+static struct led_context* led_from_file(struct file* filp){
+	return container_of(filp->private_data, struct led_context, misc);
+}
+
+// Called with ctx->lock held
+static void led_toggle(struct led_context* ctx){
+	u32 val = ioread32(ctx->base + LED_CTRL_OFFSET);
+	if(val != ctx->led_figure && val != ~ctx->led_figure)
+		val = ctx->led_figure;
+	iowrite32(~val, ctx->base + LED_CTRL_OFFSET);
+}
+
+static enum hrtimer_restart led_timer_fn(struct hrtimer* timer){
+	struct led_context* ctx = container_of(timer, struct led_context, timer);
+	ktime_t now = ktime_get();
+	s64 lateness_ns = ktime_to_ns(ktime_sub(now, hrtimer_get_expires(timer)));
+	unsigned long flags;
+	u64 periods;
+
+	raw_spin_lock_irqsave(&ctx->lock, flags);
+	led_toggle(ctx);
+	// Every period forwarded beyond the next one is an edge that was missed
+	periods = hrtimer_forward(timer, now, ctx->period);
+	led_jitter_record(&ctx->jitter, lateness_ns, periods > 1 ? periods - 1 : 0);
+	raw_spin_unlock_irqrestore(&ctx->lock, flags);
+
+	return HRTIMER_RESTART;
+}
+
+static int led_open(struct inode* inode, struct file* filp){
+	struct led_context* ctx = led_from_file(filp);
+	unsigned long flags;
+
+	if(atomic_cmpxchg(&ctx->in_use, 0, 1))
+		return -EBUSY;
+
+	iowrite32(0, ctx->base + LED_OE_OFFSET);
+
+	raw_spin_lock_irqsave(&ctx->lock, flags);
+	ctx->period = ns_to_ktime(LED_DEFAULT_PERIOD_NS);
+	ctx->led_figure = 0;
+	led_jitter_reset(&ctx->jitter);
+	raw_spin_unlock_irqrestore(&ctx->lock, flags);
+
+	hrtimer_start(&ctx->timer, ctx->period, LED_HRTIMER_MODE);
+	printk(KERN_ALERT "led device opened successfully\n");
+	return 0;
+}
+
+static int led_release(struct inode* inode, struct file* filp){
+	struct led_context* ctx = led_from_file(filp);
+
+	hrtimer_cancel(&ctx->timer);
+	atomic_set(&ctx->in_use, 0);
+	printk(KERN_ALERT "led device closed\n");
+	return 0;
+}
+
+// Returns the jitter histogram. The file offset is ignored, every read is a
+// new snapshot, like with the Xenomai driver.
+static ssize_t led_read(struct file* filp, char __user* buf, size_t size, loff_t* off){
+	struct led_context* ctx = led_from_file(filp);
+	struct led_jitter_hist hist;
+	unsigned long flags;
+
+	if(size < sizeof(hist))
+		return -EINVAL;
+
+	raw_spin_lock_irqsave(&ctx->lock, flags);
+	hist = ctx->jitter;
+	raw_spin_unlock_irqrestore(&ctx->lock, flags);
+
+	if(copy_to_user(buf, &hist, sizeof(hist)))
+		return -EFAULT;
+	return sizeof(hist);
+}
+
+static ssize_t led_write(struct file* filp, const char __user* buf, size_t size, loff_t* off){
+	struct led_context* ctx = led_from_file(filp);
+	int64_t toggle_period_ns = 0;
+	uint32_t write_value = 0;
+	unsigned long flags;
+	int retval;
+
+	if((retval = led_check_pattern_size(size)))
+		return retval;
+
+	if(copy_from_user(&toggle_period_ns, buf, 8) || copy_from_user(&write_value, buf+8, 4))
+		return -EFAULT;
+
+	if((retval = led_check_period(toggle_period_ns)))
+		return retval;
+
+	// Apply the new pattern right away and restart the period from here
+	hrtimer_cancel(&ctx->timer);
+
+	raw_spin_lock_irqsave(&ctx->lock, flags);
+	ctx->period = ns_to_ktime(toggle_period_ns);
+	ctx->led_figure = write_value;
+	led_toggle(ctx);
+	raw_spin_unlock_irqrestore(&ctx->lock, flags);
+
+	hrtimer_start(&ctx->timer, ctx->period, LED_HRTIMER_MODE);
+	return size;
+}
+
+static long led_ioctl(struct file* filp, unsigned int request, unsigned long arg){
+	struct led_context* ctx = led_from_file(filp);
+	unsigned long flags;
 
+	if(request != LED_RESET_JITTER)
+		return -ENOTTY;
+
+	raw_spin_lock_irqsave(&ctx->lock, flags);
+	led_jitter_reset(&ctx->jitter);
+	raw_spin_unlock_irqrestore(&ctx->lock, flags);
+	return 0;
+}
 
-static void* __iomem led_base;
+static const struct file_operations led_fops = {
+	.owner = THIS_MODULE,
+	.open = led_open,
+	.release = led_release,
+	.read = led_read,
+	.write = led_write,
+	.unlocked_ioctl = led_ioctl,
+};
 
 
 static int led_probe(struct platform_device* pdev){
 
 	int retval= -EIO;
 	struct resource* iomem_range;
+	struct led_context* ctx;
 
-	iomem_range = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	ctx = devm_kzalloc(&pdev->dev, sizeof(*ctx), GFP_KERNEL);
+	if(!ctx){
+		retval = -ENOMEM;
+		goto func_exit;
+	}
 
+	iomem_range = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 
-	led_base = devm_ioremap_resource(&pdev->dev, iomem_range);
+	ctx->base = devm_ioremap_resource(&pdev->dev, iomem_range);
 
-	if(IS_ERR(led_base)){
+	if(IS_ERR(ctx->base)){
 		printk(KERN_ALERT "Error: devm_ioremap_resource\n");
-		retval = PTR_ERR(led_base);
+		retval = PTR_ERR(ctx->base);
 		goto func_exit;
 	}
 
+	raw_spin_lock_init(&ctx->lock);
+	atomic_set(&ctx->in_use, 0);
+	hrtimer_init(&ctx->timer, CLOCK_MONOTONIC, LED_HRTIMER_MODE);
+	ctx->timer.function = led_timer_fn;
+
+	ctx->misc.minor = MISC_DYNAMIC_MINOR;
+	ctx->misc.name = "led0";
+	ctx->misc.fops = &led_fops;
+	ctx->misc.parent = &pdev->dev;
+
+	retval = misc_register(&ctx->misc);
+	if(retval){
+		printk(KERN_ALERT "Error: misc_register: %d\n", retval);
+		goto func_exit;
+	}
+
+	platform_set_drvdata(pdev, ctx);
 	retval = 0;
 	printk(KERN_ALERT"led_probe success\n");
 func_exit:
 	return retval;
 }
 
+static int led_remove(struct platform_device* pdev){
+	struct led_context* ctx = platform_get_drvdata(pdev);
+
+	misc_deregister(&ctx->misc);
+	hrtimer_cancel(&ctx->timer);
+	return 0;
+}
+
+static struct platform_driver led_driver = {
+	.probe = led_probe,
+	.remove = led_remove,
+	.driver = {
+		.name = "bbx15-user-led",
+	},
+};
+
 static int __init led_init(void){
-	int retval = -EIO;
-	printk(KERN_ALERT "Requesting memory region\n");
-	struct resource* led_ctrl_reg_region = request_mem_region(LED_CTRL_REG, 4, "USER2_LED");
-	if(led_ctrl_reg_region == NULL){
-	    printk(KERN_ALERT "Memory region request failed\n");
-	    goto error;
-	}
+	int retval;
 
-	struct resource* led_oe_reg_region = request_mem_region(LED_OE_REG, 4, "USER2_LED");
-	if(led_oe_reg_region == NULL){
-		printk(KERN_ALERT "Memory region 2 request failed\n");
-		goto do_free_ctrl_reg;
+	retval = platform_driver_register(&led_driver);
+	if(retval){
+		printk(KERN_ALERT "platform_driver_register failed: %d\n", retval);
+		goto error;
 	}
 
-	printk("Mapping IO memory\n");
-	void* oe_ptr = ioremap(LED_OE_REG, 4);
-	if(oe_ptr == NULL){
-		printk(KERN_ALERT "Failed to map led ctrl memory");
-		goto do_free_oe_reg;
+	// The board device tree has no node for the led, so the device is
+	// created here from the fixed register addresses
+	led_pdev = platform_device_register_simple(led_driver.driver.name, -1, &led_resource, 1);
+	if(IS_ERR(led_pdev)){
+		retval = PTR_ERR(led_pdev);
+		printk(KERN_ALERT "platform_device_register_simple failed: %d\n", retval);
+		goto do_unregister_driver;
 	}
-	void* ctrl_ptr = ioremap(LED_CTRL_REG, 4);
-	if(ctrl_ptr == NULL){
-	    printk(KERN_ALERT "Failed to map IO memory\n");
-	    goto do_iounmap_oe_ptr;
-	}
-	printk(KERN_ALERT "Successfully claimed mem region\n");
-
-	unsigned int val = ioread32(ctrl_ptr);
-	printk(KERN_ALERT "LED value before write: %i\n", val);
-	printk(KERN_ALERT "Setting USER LED\n");
 
-	iowrite32(0, oe_ptr);
-	iowrite32(val | 0xffffffff, ctrl_ptr);
-	//iowrite32(val & 0, ptr);
-	val = ioread32(ctrl_ptr);
-	printk(KERN_ALERT "LED value after write: %i\n", val);
+	return 0;
 
-	retval = 0;
-
-do_iounmap_ctrl_ptr:
-	iounmap(ctrl_ptr);
-do_iounmap_oe_ptr:
-	iounmap(oe_ptr);
-do_free_oe_reg:
-	release_mem_region(led_oe_reg_region->start, 4);
-do_free_ctrl_reg:
-	release_mem_region(led_ctrl_reg_region->start, 4);
+do_unregister_driver:
+	platform_driver_unregister(&led_driver);
 error:
 	return retval;
-
 }
 
 static void __exit led_exit(void){
 	printk(KERN_ALERT "Unregistering led driver\n");
+	platform_device_unregister(led_pdev);
+	platform_driver_unregister(&led_driver);
 }
 
 module_init(led_init);
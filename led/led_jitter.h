@@ -0,0 +1,90 @@
+#ifndef _LED_JITTER_H
+#define _LED_JITTER_H
+
+/*
+ * Interface shared by the hrtimer (led/led.c) and Xenomai (xenomai/led/led.c)
+ * led drivers, so that their timing can be compared directly.
+ *
+ * write() takes LED_PATTERN_WRITE_SIZE bytes: the toggle period in ns as a
+ * 64-bit integer followed by the 32-bit DATAOUT pattern. The pins are toggled
+ * between the pattern and its complement once per period. Any other size and
+ * periods below LED_MIN_PERIOD_NS are rejected with -EINVAL.
+ *
+ * read() returns a struct led_jitter_hist. Each sample is the lateness of one
+ * edge: the time between the moment the edge was scheduled and the moment
+ * the driver woke up to produce it. Early wakeups fall into bucket 0 and
+ * the last bucket collects everything beyond the histogram range. Edges that
+ * were skipped entirely because the driver woke up a period or more late
+ * are counted in overruns.
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define LED_PATTERN_WRITE_SIZE 12
+#define LED_MIN_PERIOD_NS 50000
+
+#define LED_JITTER_BUCKETS 64
+#define LED_JITTER_BUCKET_NS 1000
+
+struct led_jitter_hist {
+        __u32 bucket_ns;
+        __u32 nbuckets;
+        __u64 samples;
+        __s64 min_ns;
+        __s64 max_ns;
+        __s64 sum_ns;
+        __u64 overruns;
+        __u32 buckets[LED_JITTER_BUCKETS];
+};
+
+#define LED_IOC_MAGIC 'L'
+#define LED_RESET_JITTER _IO(LED_IOC_MAGIC, 0)
+
+#ifdef __KERNEL__
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+
+// Checks shared by the write() handlers of both drivers
+static inline int led_check_pattern_size(size_t size) {
+        return size == LED_PATTERN_WRITE_SIZE ? 0 : -EINVAL;
+}
+
+static inline int led_check_period(s64 period_ns) {
+        return period_ns >= LED_MIN_PERIOD_NS ? 0 : -EINVAL;
+}
+
+static inline void led_jitter_reset(struct led_jitter_hist* hist) {
+        memset(hist, 0, sizeof(*hist));
+        hist->bucket_ns = LED_JITTER_BUCKET_NS;
+        hist->nbuckets = LED_JITTER_BUCKETS;
+        hist->min_ns = S64_MAX;
+        hist->max_ns = S64_MIN;
+}
+
+/*
+ * Record an edge produced lateness_ns after it was scheduled. missed is the
+ * number of edges skipped before it.
+ */
+static inline void led_jitter_record(struct led_jitter_hist* hist,
+                                     s64 lateness_ns, u64 missed) {
+        u64 bucket = 0;
+
+        if (lateness_ns > 0)
+                bucket = div_u64(lateness_ns, LED_JITTER_BUCKET_NS);
+        if (bucket >= LED_JITTER_BUCKETS) bucket = LED_JITTER_BUCKETS - 1;
+
+        hist->buckets[bucket]++;
+        hist->samples++;
+        hist->sum_ns += lateness_ns;
+        if (lateness_ns < hist->min_ns) hist->min_ns = lateness_ns;
+        if (lateness_ns > hist->max_ns) hist->max_ns = lateness_ns;
+        hist->overruns += missed;
+}
+
+#endif  // __KERNEL__
+
+#endif  // _LED_JITTER_H
@@ -0,0 +1,168 @@
+#include "pru_client.hpp"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace pru {
+
+namespace detail {
+
+static bool is_word_aligned(const volatile void* dst, const volatile void* src,
+                            std::size_t len) {
+        return ((reinterpret_cast<std::uintptr_t>(dst) |
+                 reinterpret_cast<std::uintptr_t>(src) | len) &
+                (sizeof(std::uint32_t) - 1)) == 0;
+}
+
+void io_read(void* dst, const volatile void* src, std::size_t len) noexcept {
+        if (is_word_aligned(dst, src, len)) {
+                auto* d = static_cast<std::uint32_t*>(dst);
+                auto* s = static_cast<const volatile std::uint32_t*>(src);
+                for (std::size_t i = 0; i < len / sizeof(*d); ++i) d[i] = s[i];
+                return;
+        }
+        auto* d = static_cast<std::uint8_t*>(dst);
+        auto* s = static_cast<const volatile std::uint8_t*>(src);
+        for (std::size_t i = 0; i < len; ++i) d[i] = s[i];
+}
+
+void io_write(volatile void* dst, const void* src, std::size_t len) noexcept {
+        if (is_word_aligned(dst, src, len)) {
+                auto* d = static_cast<volatile std::uint32_t*>(dst);
+                auto* s = static_cast<const std::uint32_t*>(src);
+                for (std::size_t i = 0; i < len / sizeof(*d); ++i) d[i] = s[i];
+                return;
+        }
+        auto* d = static_cast<volatile std::uint8_t*>(dst);
+        auto* s = static_cast<const std::uint8_t*>(src);
+        for (std::size_t i = 0; i < len; ++i) d[i] = s[i];
+}
+
+}  // namespace detail
+
+int device::open(const char* path) noexcept {
+        if (is_open()) return -EBUSY;
+        fd_ = ::open(path, O_RDWR);
+        if (fd_ < 0) return -errno;
+        selected_ = -1;
+        snapshot_target_ = -1;
+        return 0;
+}
+
+void device::close() noexcept {
+        if (!is_open()) return;
+        for (std::size_t i = 0; i < region_count; ++i)
+                unmap(static_cast<region>(i));
+        ::close(fd_);
+        fd_ = -1;
+        selected_ = -1;
+        snapshot_target_ = -1;
+}
+
+void device::take(device& other) noexcept {
+        fd_ = other.fd_;
+        selected_ = other.selected_;
+        snapshot_target_ = other.snapshot_target_;
+        for (std::size_t i = 0; i < region_count; ++i) {
+                mapped_[i] = other.mapped_[i];
+                other.mapped_[i] = nullptr;
+        }
+        other.fd_ = -1;
+        other.selected_ = -1;
+        other.snapshot_target_ = -1;
+}
+
+int device::select(region r) noexcept {
+        if (selected_ == static_cast<int>(r)) return 0;
+        if (::ioctl(fd_, static_cast<unsigned>(r)) < 0) {
+                selected_ = -1;
+                return -errno;
+        }
+        selected_ = static_cast<int>(r);
+        return 0;
+}
+
+ssize_t device::read(region r, span<std::byte> dst) noexcept {
+        int res = select(r);
+        if (res) return res;
+        ssize_t n = ::read(fd_, dst.data(), dst.size());
+        return n < 0 ? -errno : n;
+}
+
+ssize_t device::write(region r, span<const std::byte> src) noexcept {
+        int res = select(r);
+        if (res) return res;
+        ssize_t n = ::write(fd_, src.data(), src.size());
+        return n < 0 ? -errno : n;
+}
+
+int device::map(region r) noexcept {
+        if (mapped_[index(r)]) return 0;
+
+        int res = select(r);
+        if (res) return res;
+
+        void* p = ::mmap(nullptr, region_size(r), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) return -errno;
+        mapped_[index(r)] = static_cast<volatile std::uint8_t*>(p);
+        return 0;
+}
+
+void device::unmap(region r) noexcept {
+        volatile std::uint8_t*& base = mapped_[index(r)];
+        if (base) ::munmap(const_cast<std::uint8_t*>(base), region_size(r));
+        base = nullptr;
+}
+
+int device::execute(const batch_base& b) noexcept {
+        for (const transfer& t : b.transfers())
+                if (!mapped_[index(t.where)]) return -ENOBUFS;
+
+        for (const transfer& t : b.transfers()) {
+                volatile std::uint8_t* base = mapped_[index(t.where)];
+                if (t.dst)
+                        detail::io_read(t.dst, base + t.offset, t.len);
+                else
+                        detail::io_write(base + t.offset, t.src, t.len);
+        }
+        return 0;
+}
+
+int device::enable_snapshot(region r, std::size_t seq_offset,
+                            std::size_t offset, std::size_t length,
+                            unsigned max_retries) noexcept {
+        if (!length) return -EINVAL;
+        pru_snapshot_config cfg{};
+        cfg.target = static_cast<__u32>(r);
+        cfg.seq_offset = static_cast<__u32>(seq_offset);
+        cfg.offset = static_cast<__u32>(offset);
+        cfg.length = static_cast<__u32>(length);
+        cfg.max_retries = max_retries;
+        if (::ioctl(fd_, PRU_SET_SNAPSHOT, &cfg) < 0) return -errno;
+        snapshot_target_ = static_cast<int>(r);
+        return 0;
+}
+
+int device::disable_snapshot() noexcept {
+        pru_snapshot_config cfg{};
+        if (::ioctl(fd_, PRU_SET_SNAPSHOT, &cfg) < 0) return -errno;
+        snapshot_target_ = -1;
+        return 0;
+}
+
+ssize_t device::read_snapshot(span<std::byte> dst) noexcept {
+        if (snapshot_target_ < 0) return -EINVAL;
+        int res = select(static_cast<region>(snapshot_target_));
+        if (res) return res;
+        ssize_t n = ::read(fd_, dst.data(), dst.size());
+        return n < 0 ? -errno : n;
+}
+
+int device::snapshot_stats(pru_snapshot_stats& stats) noexcept {
+        return ::ioctl(fd_, PRU_GET_SNAPSHOT_STATS, &stats) < 0 ? -errno : 0;
+}
+
+}  // namespace pru
@@ -0,0 +1,570 @@
+#ifndef _PRU_CLIENT_HPP
+#define _PRU_CLIENT_HPP
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "../pru_ioctl.h"
+
+/*
+ * User space client for the PRU RTDM device (pru_xeno.c).
+ *
+ * All calls report failures as negative errno values, the same way the
+ * driver does. Nothing below allocates memory once a device is opened and
+ * its RAM windows are mapped. The setup and teardown calls must not be used
+ * from a real-time loop:
+ *
+ *   - device::open(), map(), unmap() and close()
+ *   - the async_runner constructor and destructor, which create and destroy
+ *     its mutex and condition variables and join the worker thread
+ *   - async_runner::start(), which creates the worker thread
+ *
+ * Everything else may be used from a real-time thread. Note that
+ * async_runner::submit() takes a mutex that the worker also holds while it
+ * dequeues a batch and while it marks one done, so submit() can block for
+ * that long, and that drain() blocks until the worker is idle.
+ *
+ * Link with the flags of "xeno-config --skin=posix --ldflags" so that the
+ * POSIX calls made here are routed to the Cobalt core.
+ */
+namespace pru {
+
+enum class region : unsigned {
+        iram = PRU_ACCESS_IRAM,
+        dram = PRU_ACCESS_DRAM,
+        shram = PRU_ACCESS_SHRAM,
+};
+
+constexpr std::size_t region_count = PRU_ACCESS_TARGET_COUNT;
+
+template <region R>
+struct region_traits;
+
+template <>
+struct region_traits<region::iram> {
+        static constexpr std::size_t size = PRUSS_PRU_IRAM_SIZE;
+};
+
+template <>
+struct region_traits<region::dram> {
+        static constexpr std::size_t size = PRUSS_PRU_DRAM_SIZE;
+};
+
+template <>
+struct region_traits<region::shram> {
+        static constexpr std::size_t size = PRUSS_SHARED_RAM_SIZE;
+};
+
+constexpr std::size_t region_size(region r) {
+        switch (r) {
+                case region::iram:
+                        return region_traits<region::iram>::size;
+                case region::dram:
+                        return region_traits<region::dram>::size;
+                case region::shram:
+                        return region_traits<region::shram>::size;
+        }
+        return 0;
+}
+
+/*
+ * Minimal non-owning view over contiguous memory. The SDK compiler predates
+ * std::span, so only the subset used here is provided.
+ */
+template <class T>
+class span {
+       public:
+        constexpr span() noexcept = default;
+        constexpr span(T* data, std::size_t size) noexcept
+            : data_(data), size_(size) {}
+        template <std::size_t N>
+        constexpr span(T (&arr)[N]) noexcept : data_(arr), size_(N) {}
+        template <class U, std::size_t N,
+                  class = typename std::enable_if<
+                      std::is_convertible<U (*)[], T (*)[]>::value>::type>
+        constexpr span(std::array<U, N>& arr) noexcept
+            : data_(arr.data()), size_(N) {}
+        template <class U,
+                  class = typename std::enable_if<
+                      std::is_convertible<U (*)[], T (*)[]>::value>::type>
+        constexpr span(const span<U>& other) noexcept
+            : data_(other.data()), size_(other.size()) {}
+
+        constexpr T* data() const noexcept { return data_; }
+        constexpr std::size_t size() const noexcept { return size_; }
+        constexpr std::size_t size_bytes() const noexcept {
+                return size_ * sizeof(T);
+        }
+        constexpr bool empty() const noexcept { return size_ == 0; }
+        constexpr T* begin() const noexcept { return data_; }
+        constexpr T* end() const noexcept { return data_ + size_; }
+        constexpr T& operator[](std::size_t i) const noexcept {
+                return data_[i];
+        }
+        constexpr span subspan(std::size_t offset, std::size_t count) const
+            noexcept {
+                return span(data_ + offset, count);
+        }
+
+       private:
+        T* data_ = nullptr;
+        std::size_t size_ = 0;
+};
+
+template <class T>
+span<std::byte> as_writable_bytes(T& obj) noexcept {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Only trivially copyable objects can be transferred");
+        return span<std::byte>(reinterpret_cast<std::byte*>(&obj), sizeof(T));
+}
+
+template <class T>
+span<const std::byte> as_bytes(const T& obj) noexcept {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Only trivially copyable objects can be transferred");
+        return span<const std::byte>(reinterpret_cast<const std::byte*>(&obj),
+                                     sizeof(T));
+}
+
+/*
+ * A firmware defined object of type T located at a fixed byte offset of a
+ * PRU RAM. Describe the firmware layout once with these and every access is
+ * checked at compile time:
+ *
+ *   using sample_count = pru::field<pru::region::dram, uint32_t, 0x100>;
+ *   uint32_t n = dev.view<pru::region::dram>().load<sample_count>();
+ */
+template <region R, class T, std::size_t Offset>
+struct field {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Firmware fields must be trivially copyable");
+        static_assert(Offset % alignof(T) == 0, "Misaligned firmware field");
+        static_assert(Offset + sizeof(T) <= region_traits<R>::size,
+                      "Firmware field exceeds the PRU RAM");
+
+        using type = T;
+        static constexpr region where = R;
+        static constexpr std::size_t offset = Offset;
+};
+
+namespace detail {
+
+/*
+ * Copies to and from PRU RAM using aligned 32-bit accesses where possible.
+ * The RAM is mapped as device memory so plain memcpy() must not be used.
+ */
+void io_read(void* dst, const volatile void* src, std::size_t len) noexcept;
+void io_write(volatile void* dst, const void* src, std::size_t len) noexcept;
+
+}  // namespace detail
+
+class device;
+
+/*
+ * Typed, non-owning view over one mmap()ed PRU RAM, obtained from
+ * device::view(). Loads and stores go straight to the PRU. The view is
+ * invalid if the RAM has not been mapped with device::map(); accessing an
+ * invalid view is a programming error caught by assert().
+ */
+template <region R>
+class region_view {
+       public:
+        static constexpr std::size_t size = region_traits<R>::size;
+
+        bool valid() const noexcept { return base_ != nullptr; }
+
+        template <class Field>
+        typename Field::type load() const noexcept {
+                static_assert(Field::where == R,
+                              "Field belongs to a different PRU RAM");
+                assert(valid());
+                typename Field::type value;
+                detail::io_read(&value, base_ + Field::offset, sizeof(value));
+                return value;
+        }
+
+        template <class Field>
+        void store(const typename Field::type& value) const noexcept {
+                static_assert(Field::where == R,
+                              "Field belongs to a different PRU RAM");
+                assert(valid());
+                detail::io_write(base_ + Field::offset, &value, sizeof(value));
+        }
+
+        // Array of Count scalars starting at Offset
+        template <class T, std::size_t Offset, std::size_t Count>
+        span<volatile T> array() const noexcept {
+                static_assert(std::is_arithmetic<T>::value,
+                              "Only scalar arrays can be viewed in place");
+                static_assert(Offset % alignof(T) == 0,
+                              "Misaligned firmware array");
+                static_assert(Offset + Count * sizeof(T) <= size,
+                              "Firmware array exceeds the PRU RAM");
+                assert(valid());
+                return span<volatile T>(
+                    reinterpret_cast<volatile T*>(base_ + Offset), Count);
+        }
+
+        /*
+         * Consistent copy of Field guarded by the sequence word Seq, using
+         * the protocol described in pru_ioctl.h, without any system calls.
+         * Returns the number of attempts that found the firmware mid-update,
+         * counted like pru_snapshot_stats::retries, or -EAGAIN once the
+         * first attempt and max_retries retries have all failed.
+         */
+        template <class Seq, class Field>
+        int snapshot(typename Field::type& out, unsigned max_retries) const
+            noexcept {
+                static_assert(
+                    std::is_same<typename Seq::type, std::uint32_t>::value,
+                    "Sequence word must be 32 bits");
+                static_assert(Seq::where == R && Field::where == R,
+                              "Field belongs to a different PRU RAM");
+                for (unsigned retries = 0;; ++retries) {
+                        std::uint32_t begin = load<Seq>();
+                        if (!(begin & 1)) {
+                                std::atomic_thread_fence(
+                                    std::memory_order_acquire);
+                                out = load<Field>();
+                                std::atomic_thread_fence(
+                                    std::memory_order_acquire);
+                                if (load<Seq>() == begin)
+                                        return static_cast<int>(retries);
+                        }
+                        if (retries == max_retries) return -EAGAIN;
+                }
+        }
+
+        span<volatile std::uint8_t> bytes() const noexcept {
+                assert(valid());
+                return span<volatile std::uint8_t>(base_, size);
+        }
+
+       private:
+        friend class device;
+
+        explicit region_view(volatile std::uint8_t* base) : base_(base) {}
+
+        volatile std::uint8_t* base_;
+};
+
+struct transfer {
+        region where;
+        std::size_t offset;
+        std::size_t len;
+        std::byte* dst;        // Set for reads from PRU RAM
+        const std::byte* src;  // Set for writes to PRU RAM
+};
+
+/*
+ * A list of transfers executed together by device::execute() on mmap()ed
+ * RAMs, in the order they were added. Only the bytes of each transfer are
+ * touched, so the rest of the RAM may be updated by the firmware meanwhile.
+ *
+ * The buffers referenced by the transfers must stay valid until the batch has
+ * been executed.
+ */
+class batch_base {
+       public:
+        batch_base(const batch_base&) = delete;
+        batch_base& operator=(const batch_base&) = delete;
+
+        int add_read(region r, std::size_t offset,
+                     span<std::byte> dst) noexcept {
+                return add(r, offset, dst.size(), dst.data(), nullptr);
+        }
+
+        int add_write(region r, std::size_t offset,
+                      span<const std::byte> src) noexcept {
+                return add(r, offset, src.size(), nullptr, src.data());
+        }
+
+        template <class Field>
+        int add_load(typename Field::type& dst) noexcept {
+                return add_read(Field::where, Field::offset,
+                                as_writable_bytes(dst));
+        }
+
+        template <class Field>
+        int add_store(const typename Field::type& src) noexcept {
+                return add_write(Field::where, Field::offset, as_bytes(src));
+        }
+
+        void clear() noexcept { count_ = 0; }
+        std::size_t size() const noexcept { return count_; }
+        std::size_t capacity() const noexcept { return capacity_; }
+        span<const transfer> transfers() const noexcept {
+                return span<const transfer>(storage_, count_);
+        }
+
+       protected:
+        batch_base(transfer* storage, std::size_t capacity) noexcept
+            : storage_(storage), capacity_(capacity) {}
+        ~batch_base() = default;
+
+       private:
+        int add(region r, std::size_t offset, std::size_t len, std::byte* dst,
+                const std::byte* src) noexcept {
+                if (offset > region_size(r) || len > region_size(r) - offset)
+                        return -EINVAL;
+                if (count_ == capacity_) return -ENOSPC;
+                storage_[count_++] = transfer{r, offset, len, dst, src};
+                return 0;
+        }
+
+        transfer* storage_;
+        std::size_t capacity_;
+        std::size_t count_ = 0;
+};
+
+namespace detail {
+
+template <std::size_t N>
+struct batch_storage {
+        std::array<transfer, N> slots;
+};
+
+}  // namespace detail
+
+// Inherits the storage first so it exists before batch_base refers to it
+template <std::size_t N>
+class batch : private detail::batch_storage<N>, public batch_base {
+       public:
+        batch() noexcept : batch_base(this->slots.data(), N) {}
+};
+
+/*
+ * RAII handle for the PRU RTDM device. Not thread safe: while an
+ * async_runner is attached, submit all work through the runner.
+ */
+class device {
+       public:
+        static constexpr const char* default_path = "/dev/rtdm/pru0";
+
+        device() noexcept = default;
+        ~device() { close(); }
+        device(const device&) = delete;
+        device& operator=(const device&) = delete;
+        device(device&& other) noexcept { take(other); }
+        device& operator=(device&& other) noexcept {
+                if (this != &other) {
+                        close();
+                        take(other);
+                }
+                return *this;
+        }
+
+        int open(const char* path = default_path) noexcept;
+        void close() noexcept;
+        bool is_open() const noexcept { return fd_ >= 0; }
+        int native_handle() const noexcept { return fd_; }
+
+        // Select the RAM used by read()/write(). Skips the ioctl if the RAM
+        // is already selected.
+        int select(region r) noexcept;
+
+        // Both transfer from the beginning of the RAM, as the driver does
+        ssize_t read(region r, span<std::byte> dst) noexcept;
+        ssize_t write(region r, span<const std::byte> src) noexcept;
+
+        // mmap() a RAM for view() and execute()
+        int map(region r) noexcept;
+        void unmap(region r) noexcept;
+
+        // Returns an invalid view if R is not mapped
+        template <region R>
+        region_view<R> view() noexcept {
+                return region_view<R>(mapped_[index(R)]);
+        }
+
+        // Execute all transfers of the batch. Returns 0 or negative errno,
+        // -ENOBUFS if a RAM used by the batch is not mapped. Nothing is
+        // transferred on failure.
+        int execute(const batch_base& b) noexcept;
+
+        /*
+         * Driver side snapshot reads, see pru_ioctl.h. While enabled, read()
+         * of r returns only the snapshot range. max_retries above
+         * PRU_SNAPSHOT_MAX_RETRIES is rejected with -EINVAL.
+         */
+        int enable_snapshot(region r, std::size_t seq_offset,
+                            std::size_t offset, std::size_t length,
+                            unsigned max_retries) noexcept;
+
+        template <class Seq, class Field>
+        int enable_snapshot(unsigned max_retries) noexcept {
+                static_assert(
+                    std::is_same<typename Seq::type, std::uint32_t>::value,
+                    "Sequence word must be 32 bits");
+                static_assert(Seq::where == Field::where,
+                              "Sequence word and field in different PRU RAMs");
+                return enable_snapshot(Field::where, Seq::offset,
+                                       Field::offset,
+                                       sizeof(typename Field::type),
+                                       max_retries);
+        }
+
+        int disable_snapshot() noexcept;
+
+        // Returns the snapshot length or negative errno (-EAGAIN on retry
+        // exhaustion)
+        ssize_t read_snapshot(span<std::byte> dst) noexcept;
+
+        template <class Field>
+        int read_snapshot(typename Field::type& out) noexcept {
+                ssize_t n = read_snapshot(as_writable_bytes(out));
+                if (n < 0) return static_cast<int>(n);
+                return static_cast<std::size_t>(n) == sizeof(out) ? 0 : -EIO;
+        }
+
+        int snapshot_stats(pru_snapshot_stats& stats) noexcept;
+
+       private:
+        static constexpr std::size_t index(region r) {
+                return static_cast<std::size_t>(r);
+        }
+
+        void take(device& other) noexcept;
+
+        int fd_ = -1;
+        int selected_ = -1;
+        int snapshot_target_ = -1;
+        volatile std::uint8_t* mapped_[region_count] = {};
+};
+
+/*
+ * Called from the runner thread once a batch has been executed. result is the
+ * return value of device::execute().
+ */
+using completion_fn = void (*)(const batch_base& b, int result, void* user);
+
+/*
+ * Executes batches on a worker thread and reports completion through a
+ * callback. The queue has a fixed depth so submitting never allocates.
+ *
+ * The worker is created by start() with the caller's thread attributes, so
+ * it can be given a real-time policy and priority, e.g.
+ *
+ *   pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+ *   pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+ *
+ * Only POSIX primitives are used so that libcobalt can take them over.
+ */
+template <std::size_t Depth>
+class async_runner {
+       public:
+        explicit async_runner(device& dev) : dev_(dev) {
+                pthread_mutex_init(&mutex_, nullptr);
+                pthread_cond_init(&wake_, nullptr);
+                pthread_cond_init(&idle_, nullptr);
+        }
+
+        ~async_runner() {
+                if (started_) {
+                        pthread_mutex_lock(&mutex_);
+                        stopping_ = true;
+                        pthread_cond_signal(&wake_);
+                        pthread_mutex_unlock(&mutex_);
+                        pthread_join(worker_, nullptr);
+                }
+                pthread_cond_destroy(&idle_);
+                pthread_cond_destroy(&wake_);
+                pthread_mutex_destroy(&mutex_);
+        }
+
+        async_runner(const async_runner&) = delete;
+        async_runner& operator=(const async_runner&) = delete;
+
+        // Create the worker thread. attr may be null for default attributes.
+        int start(const pthread_attr_t* attr = nullptr) noexcept {
+                if (started_) return -EBUSY;
+                int res = pthread_create(&worker_, attr, &async_runner::run,
+                                         this);
+                if (res) return -res;
+                started_ = true;
+                return 0;
+        }
+
+        // Returns -EAGAIN if Depth batches are already pending, -ESRCH if the
+        // runner has not been started
+        int submit(const batch_base& b, completion_fn done,
+                   void* user = nullptr) noexcept {
+                if (!started_) return -ESRCH;
+                pthread_mutex_lock(&mutex_);
+                if (count_ == Depth) {
+                        pthread_mutex_unlock(&mutex_);
+                        return -EAGAIN;
+                }
+                queue_[(head_ + count_) % Depth] = pending{&b, done, user};
+                ++count_;
+                pthread_cond_signal(&wake_);
+                pthread_mutex_unlock(&mutex_);
+                return 0;
+        }
+
+        // Block until every submitted batch has completed
+        void drain() noexcept {
+                pthread_mutex_lock(&mutex_);
+                while (count_ != 0 || busy_)
+                        pthread_cond_wait(&idle_, &mutex_);
+                pthread_mutex_unlock(&mutex_);
+        }
+
+       private:
+        struct pending {
+                const batch_base* b;
+                completion_fn done;
+                void* user;
+        };
+
+        static void* run(void* arg) {
+                auto* self = static_cast<async_runner*>(arg);
+                for (;;) {
+                        pthread_mutex_lock(&self->mutex_);
+                        while (!self->stopping_ && self->count_ == 0)
+                                pthread_cond_wait(&self->wake_,
+                                                  &self->mutex_);
+                        if (self->count_ == 0) {
+                                pthread_mutex_unlock(&self->mutex_);
+                                return nullptr;
+                        }
+                        pending p = self->queue_[self->head_];
+                        self->head_ = (self->head_ + 1) % Depth;
+                        --self->count_;
+                        self->busy_ = true;
+                        pthread_mutex_unlock(&self->mutex_);
+
+                        int res = self->dev_.execute(*p.b);
+                        if (p.done) p.done(*p.b, res, p.user);
+
+                        pthread_mutex_lock(&self->mutex_);
+                        self->busy_ = false;
+                        pthread_cond_broadcast(&self->idle_);
+                        pthread_mutex_unlock(&self->mutex_);
+                }
+        }
+
+        device& dev_;
+        pthread_mutex_t mutex_;
+        pthread_cond_t wake_;
+        pthread_cond_t idle_;
+        pthread_t worker_;
+        std::array<pending, Depth> queue_{};
+        std::size_t head_ = 0;
+        std::size_t count_ = 0;
+        bool busy_ = false;
+        bool stopping_ = false;
+        bool started_ = false;
+};
+
+}  // namespace pru
+
+#endif  // _PRU_CLIENT_HPP
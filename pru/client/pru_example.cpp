@@ -0,0 +1,107 @@
+/*
+ * Example client for the PRU RTDM device. Besides showing the intended use of
+ * the library, building it instantiates every template of pru_client.hpp, so
+ * a broken header fails the build instead of the first application using it.
+ *
+ * The firmware layout below is only an example: a control word and a
+ * sequence guarded status block in the data RAM, and a sample ring in the
+ * shared RAM.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "pru_client.hpp"
+
+// Every RAM gets a view, even the ones not used below
+template class pru::region_view<pru::region::iram>;
+template class pru::region_view<pru::region::dram>;
+template class pru::region_view<pru::region::shram>;
+template class pru::async_runner<4>;
+
+namespace {
+
+struct status_block {
+        std::uint32_t state;
+        std::uint32_t cycles;
+        std::uint64_t timestamp;
+};
+
+using control = pru::field<pru::region::dram, std::uint32_t, 0x000>;
+using status_seq = pru::field<pru::region::dram, std::uint32_t, 0x100>;
+using status = pru::field<pru::region::dram, status_block, 0x108>;
+using ring_head = pru::field<pru::region::shram, std::uint32_t, 0x000>;
+
+constexpr std::size_t ring_offset = 0x100;
+constexpr std::size_t ring_length = 256;
+constexpr unsigned max_retries = 8;
+
+void on_done(const pru::batch_base& b, int result, void*) {
+        std::printf("batch of %zu transfers done: %d\n", b.size(), result);
+}
+
+int fail(const char* what, long res) {
+        std::fprintf(stderr, "%s: %s\n", what,
+                     std::strerror(static_cast<int>(-res)));
+        return 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+        const char* path = argc > 1 ? argv[1] : pru::device::default_path;
+        pru::device dev;
+        int res;
+
+        if ((res = dev.open(path))) return fail("open", res);
+        if ((res = dev.map(pru::region::dram))) return fail("map dram", res);
+        if ((res = dev.map(pru::region::shram)))
+                return fail("map shram", res);
+
+        // Direct access through the mapped RAM
+        auto dram = dev.view<pru::region::dram>();
+        auto shram = dev.view<pru::region::shram>();
+        dram.store<control>(1);
+
+        status_block st;
+        res = dram.snapshot<status_seq, status>(st, max_retries);
+        if (res < 0) return fail("snapshot", res);
+        std::printf("state %u after %d retries\n", st.state, res);
+
+        auto ring = shram.array<std::uint32_t, ring_offset, ring_length>();
+        std::uint32_t head = shram.load<ring_head>() % ring.size();
+        std::printf("last sample %u of %zu mapped bytes\n",
+                    ring[(head + ring.size() - 1) % ring.size()],
+                    shram.bytes().size());
+
+        // Several transfers in one go, first inline and then on the worker
+        pru::batch<4> b;
+        std::uint32_t ctl = 0;
+        std::uint32_t first[16];
+        b.add_load<control>(ctl);
+        b.add_read(pru::region::shram, ring_offset,
+                   pru::as_writable_bytes(first));
+        if ((res = dev.execute(b))) return fail("execute", res);
+
+        pru::async_runner<4> runner(dev);
+        if ((res = runner.start())) return fail("start", res);
+        b.clear();
+        b.add_store<control>(ctl | 2);
+        if ((res = runner.submit(b, on_done))) return fail("submit", res);
+        runner.drain();
+
+        // The same status block, read by the driver
+        if ((res = dev.enable_snapshot<status_seq, status>(max_retries)))
+                return fail("enable_snapshot", res);
+        if ((res = dev.read_snapshot<status>(st)))
+                return fail("read_snapshot", res);
+
+        pru_snapshot_stats stats;
+        if ((res = dev.snapshot_stats(stats)))
+                return fail("snapshot_stats", res);
+        std::printf("driver snapshots: %llu reads, %llu retries\n",
+                    static_cast<unsigned long long>(stats.reads),
+                    static_cast<unsigned long long>(stats.retries));
+        dev.disable_snapshot();
+        return 0;
+}
@@ -2,6 +2,7 @@
 #include "pru_ctrl.h"
 #include <linux/errno.h>
 #include <linux/ioport.h>
+#include <linux/string.h>
 #include <rtdm/driver.h>
 
 int pru_claim_memory_regions(void) {
@@ -20,11 +21,16 @@ int pru_claim_memory_regions(void) {
         res = request_mem_region(PRUSS1_PRU0_DRAM_ADDR, PRUSS_PRU_DRAM_SIZE,
                                  "PRU-ICSS1 PRU0 DRAM");
         if (!res) goto do_free_iram;
+        res = request_mem_region(PRUSS1_SHARED_RAM_ADDR, PRUSS_SHARED_RAM_SIZE,
+                                 "PRU-ICSS1 SHARED RAM");
+        if (!res) goto do_free_dram;
 
         rtdm_printk(KERN_INFO "Memory regions requested successfully\n");
 
         return 0;
 
+do_free_dram:
+        release_mem_region(PRUSS1_PRU0_DRAM_ADDR, PRUSS_PRU_DRAM_SIZE);
 do_free_iram:
         release_mem_region(PRUSS1_PRU0_IRAM_ADDR, PRUSS_PRU_IRAM_SIZE);
 do_free_cfg:
@@ -42,6 +48,7 @@ void pru_release_memory_regions(void) {
         release_mem_region(PRUSS1_CFG_REG_ADDR, PRUSS_CFG_REG_SIZE);
         release_mem_region(PRUSS1_PRU0_IRAM_ADDR, PRUSS_PRU_IRAM_SIZE);
         release_mem_region(PRUSS1_PRU0_DRAM_ADDR, PRUSS_PRU_DRAM_SIZE);
+        release_mem_region(PRUSS1_SHARED_RAM_ADDR, PRUSS_SHARED_RAM_SIZE);
 }
 
 int pru_init_context(struct pru_context* pctx, enum pru_icss_index pru_num) {
@@ -51,7 +58,10 @@ int pru_init_context(struct pru_context* pctx, enum pru_icss_index pru_num) {
         pctx->pcfg = NULL;
         pctx->piram = NULL;
         pctx->pdram = NULL;
+        pctx->pshram = NULL;
         pctx->ram_target = PRU_ACCESS_IRAM;
+        memset(&pctx->snapshot, 0, sizeof(pctx->snapshot));
+        memset(&pctx->snapshot_stats, 0, sizeof(pctx->snapshot_stats));
 
         if (pru_num == PRU_ICSS1) {
                 pctx->pclk = ioremap(CM_L4PER2_PRUSS1_CLKCTRL_ADDR, 4);
@@ -60,7 +70,10 @@ int pru_init_context(struct pru_context* pctx, enum pru_icss_index pru_num) {
                     ioremap(PRUSS1_PRU0_IRAM_ADDR, PRUSS_PRU_IRAM_SIZE);
                 pctx->pdram =
                     ioremap(PRUSS1_PRU0_DRAM_ADDR, PRUSS_PRU_DRAM_SIZE);
-                if (pctx->pclk && pctx->pcfg && pctx->piram && pctx->pdram)
+                pctx->pshram =
+                    ioremap(PRUSS1_SHARED_RAM_ADDR, PRUSS_SHARED_RAM_SIZE);
+                if (pctx->pclk && pctx->pcfg && pctx->piram && pctx->pdram &&
+                    pctx->pshram)
                         goto exit_success;
                 else
                         err = -EIO;
@@ -75,11 +88,13 @@ int pru_init_context(struct pru_context* pctx, enum pru_icss_index pru_num) {
         if (pctx->pcfg) iounmap(pctx->pcfg);
         if (pctx->piram) iounmap(pctx->piram);
         if (pctx->pdram) iounmap(pctx->pdram);
+        if (pctx->pshram) iounmap(pctx->pshram);
 
         pctx->pclk = NULL;
         pctx->pcfg = NULL;
         pctx->piram = NULL;
         pctx->pdram = NULL;
+        pctx->pshram = NULL;
 
 exit_failure:
         rtdm_printk(KERN_ERR "Failed to initialize PRU context\n");
@@ -96,10 +111,12 @@ void pru_free_context(struct pru_context* pctx) {
         if (pctx->pcfg) iounmap(pctx->pcfg);
         if (pctx->piram) iounmap(pctx->piram);
         if (pctx->pdram) iounmap(pctx->pdram);
+        if (pctx->pshram) iounmap(pctx->pshram);
         pctx->pclk = NULL;
         pctx->pcfg = NULL;
         pctx->piram = NULL;
         pctx->pdram = NULL;
+        pctx->pshram = NULL;
 }
 
 void pru_set_device_state_async(struct pru_context* pctx,
@@ -4,6 +4,8 @@
 #include <linux/io.h>
 #include <rtdm/driver.h>
 
+#include "pru_ioctl.h"
+
 // Address definitions
 #define PRUSS1_SLAVE_PORT_ADDR 0x4b200000
 #define PRUSS1_CFG_REG_ADDR 0x4b226000
@@ -15,13 +17,12 @@
 
 #define PRUSS1_PRU0_IRAM_ADDR (PRUSS1_SLAVE_PORT_ADDR + 0x34000)
 #define PRUSS1_PRU1_IRAM_ADDR (PRUSS1_SLAVE_PORT_ADDR + 0x38000)
-#define PRUSS_PRU_IRAM_SIZE (12 * 1024)
 
 #define PRUSS1_PRU0_DRAM_ADDR (PRUSS1_SLAVE_PORT_ADDR)
 #define PRUSS1_PRU1_DRAM_ADDR (PRUSS1_SLAVE_PORT_ADDR + 0x2000)
-#define PRUSS_PRU_DRAM_SIZE (8 * 1024)
 
-enum pru_ram_access_target { PRU_ACCESS_IRAM = 0, PRU_ACCESS_DRAM };
+#define PRUSS1_SHARED_RAM_ADDR (PRUSS1_SLAVE_PORT_ADDR + 0x10000)
+
 enum pru_icss_index { PRU_ICSS1 = 0, PRU_ICSS2 };
 enum pru_device_state { PRU_STATE_ENABLED = 0, PRU_STATE_DISABLED = 1 };
 
@@ -30,14 +31,31 @@ struct pru_context {
         void* pcfg;
         void* piram;
         void* pdram;
+        void* pshram;
         enum pru_ram_access_target ram_target;
+        struct pru_snapshot_config snapshot;
+        struct pru_snapshot_stats snapshot_stats;
 };
 
-#define pru_to_ram_ptr(pctx) \
-        ((pctx)->ram_target == PRU_ACCESS_IRAM ? (pctx)->piram : (pctx)->pdram)
-#define pru_to_ram_size(pctx)                                        \
-        ((pctx)->ram_target == PRU_ACCESS_IRAM ? PRUSS_PRU_IRAM_SIZE \
-                                               : PRUSS_PRU_DRAM_SIZE)
+/*
+ * ram_target may be changed by a concurrent ioctl, so read it once and pass
+ * the same value to all of these.
+ */
+#define pru_target_ram_ptr(pctx, target)                                     \
+        ((target) == PRU_ACCESS_IRAM                                         \
+             ? (pctx)->piram                                                 \
+             : (target) == PRU_ACCESS_DRAM ? (pctx)->pdram                   \
+                                           : (pctx)->pshram)
+#define pru_target_ram_size(target)                                          \
+        ((target) == PRU_ACCESS_IRAM                                         \
+             ? PRUSS_PRU_IRAM_SIZE                                           \
+             : (target) == PRU_ACCESS_DRAM ? PRUSS_PRU_DRAM_SIZE             \
+                                           : PRUSS_SHARED_RAM_SIZE)
+#define pru_target_ram_phys(target)                                          \
+        ((target) == PRU_ACCESS_IRAM                                         \
+             ? PRUSS1_PRU0_IRAM_ADDR                                         \
+             : (target) == PRU_ACCESS_DRAM ? PRUSS1_PRU0_DRAM_ADDR           \
+                                           : PRUSS1_SHARED_RAM_ADDR)
 
 int pru_claim_memory_regions(void);
 void pru_release_memory_regions(void);
@@ -0,0 +1,65 @@
+#ifndef _PRU_IOCTL_H
+#define _PRU_IOCTL_H
+
+/*
+ * Interface shared between the PRU RTDM driver and its user space clients.
+ * Must stay includable from both kernel and user space (C and C++).
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define PRUSS_PRU_IRAM_SIZE (12 * 1024)
+#define PRUSS_PRU_DRAM_SIZE (8 * 1024)
+#define PRUSS_SHARED_RAM_SIZE (32 * 1024)
+
+/*
+ * ioctl request codes selecting the RAM accessed by read(), write() and
+ * mmap(). The request code itself is the target, no argument is passed.
+ */
+enum pru_ram_access_target {
+        PRU_ACCESS_IRAM = 0,
+        PRU_ACCESS_DRAM,
+        PRU_ACCESS_SHRAM
+};
+
+#define PRU_ACCESS_TARGET_COUNT 3
+
+/*
+ * Snapshot reads
+ *
+ * The firmware guards multi-word state with a 32-bit sequence word: it
+ * increments the word (making it odd) before updating the state and
+ * increments it again (making it even) once done. With snapshot mode enabled,
+ * read() of the configured target copies only the configured range and
+ * retries until the sequence word is even and unchanged across the copy.
+ * If the first attempt and max_retries retries all fail, read() returns
+ * -EAGAIN. max_retries may not exceed PRU_SNAPSHOT_MAX_RETRIES, as the
+ * retries run in primary mode.
+ *
+ * Offsets are in bytes from the start of the target RAM. A zero length
+ * disables snapshot mode. Every PRU_SET_SNAPSHOT, including one that
+ * disables snapshot mode, resets the statistics.
+ */
+#define PRU_SNAPSHOT_MAX_RETRIES 64
+
+struct pru_snapshot_config {
+        __u32 target;
+        __u32 seq_offset;
+        __u32 offset;
+        __u32 length;
+        __u32 max_retries;
+};
+
+struct pru_snapshot_stats {
+        __u64 reads;     // Consistent snapshots returned
+        __u64 retries;   // Attempts that found the firmware mid-update
+        __u64 failures;  // Reads that ran out of retries
+};
+
+#define PRU_IOC_MAGIC 'P'
+#define PRU_SET_SNAPSHOT _IOW(PRU_IOC_MAGIC, 0, struct pru_snapshot_config)
+#define PRU_GET_SNAPSHOT_STATS \
+        _IOR(PRU_IOC_MAGIC, 1, struct pru_snapshot_stats)
+
+#endif  // _PRU_IOCTL_H
@@ -66,21 +66,98 @@ static void pru_close(struct rtdm_fd* fd) {
         pru_free_context(pctx);
 }
 
+static bool pru_snapshot_valid(const struct pru_snapshot_config* cfg,
+                               size_t ram_size) {
+        return cfg->max_retries <= PRU_SNAPSHOT_MAX_RETRIES &&
+               cfg->seq_offset % 4 == 0 && cfg->seq_offset <= ram_size - 4 &&
+               cfg->offset <= ram_size && cfg->length <= ram_size - cfg->offset;
+}
+
+/*
+ * Copy the snapshot range to kbuf. Returns false if the firmware was updating
+ * the range during the copy.
+ */
+static bool pru_try_snapshot(void* pru_ram_ptr,
+                             const struct pru_snapshot_config* cfg, void* kbuf,
+                             size_t len) {
+        u32 seq_begin = ioread32(pru_ram_ptr + cfg->seq_offset);
+        u32 seq_end;
+
+        if (seq_begin & 1) return false;
+        memcpy_fromio(kbuf, pru_ram_ptr + cfg->offset, len);
+        rmb();
+        seq_end = ioread32(pru_ram_ptr + cfg->seq_offset);
+        return seq_begin == seq_end;
+}
+
+/*
+ * cfg is a private copy already validated against the RAM at pru_ram_ptr, so
+ * a concurrent PRU_SET_SNAPSHOT can not move the copy out of the mapping.
+ */
+static ssize_t pru_read_snapshot(struct rtdm_fd* fd, struct pru_context* pctx,
+                                 const struct pru_snapshot_config* cfg,
+                                 void* pru_ram_ptr, void __user* buf,
+                                 size_t size) {
+        size_t len = min_t(size_t, cfg->length, size);
+        unsigned int retries = 0;
+        void* kbuf;
+        int res;
+
+        kbuf = rtdm_malloc(len);
+        if (!kbuf) return -ENOMEM;
+
+        while (!pru_try_snapshot(pru_ram_ptr, cfg, kbuf, len)) {
+                if (retries == cfg->max_retries) {
+                        // The last attempt failed too
+                        pctx->snapshot_stats.retries += retries + 1;
+                        pctx->snapshot_stats.failures++;
+                        rtdm_free(kbuf);
+                        return -EAGAIN;
+                }
+                retries++;
+        }
+        pctx->snapshot_stats.retries += retries;
+        pctx->snapshot_stats.reads++;
+
+        res = rtdm_copy_to_user(fd, buf, kbuf, len);
+
+        rtdm_free(kbuf);
+        if (res) return res;
+        return len;
+}
+
 static ssize_t pru_read_rt(struct rtdm_fd* fd, void __user* buf, size_t size) {
         struct pru_context* pctx = rtdm_fd_to_private(fd);
+        struct pru_snapshot_config cfg;
+        enum pru_ram_access_target target;
         if (!pctx) return -EINVAL;
-        size_t pru_ram_size = pru_to_ram_size(pctx);
-        void* pru_ram_ptr = pru_to_ram_ptr(pctx);
+        if (!size) return 0;
+
+        // ioctl_rt may run concurrently, use only these copies from here on
+        target = READ_ONCE(pctx->ram_target);
+        cfg = pctx->snapshot;
+        size_t ram_size = pru_target_ram_size(target);
+        void* pru_ram_ptr = pru_target_ram_ptr(pctx, target);
 
-        void* kbuf = rtdm_malloc(pru_ram_size);
+        if (cfg.length && cfg.target == target) {
+                // Torn by a concurrent PRU_SET_SNAPSHOT
+                if (!pru_snapshot_valid(&cfg, ram_size)) return -EAGAIN;
+                return pru_read_snapshot(fd, pctx, &cfg, pru_ram_ptr, buf,
+                                         size);
+        }
+
+        size_t len = min_t(size_t, ram_size, size);
+
+        // Only the requested prefix is copied out of the PRU RAM
+        void* kbuf = rtdm_malloc(len);
         if (!kbuf) return -ENOMEM;
-        memcpy_fromio(kbuf, pru_ram_ptr, pru_ram_size);
+        memcpy_fromio(kbuf, pru_ram_ptr, len);
 
-        int res = rtdm_copy_to_user(fd, buf, kbuf, min(pru_ram_size, size));
+        int res = rtdm_copy_to_user(fd, buf, kbuf, len);
 
         rtdm_free(kbuf);
         if (res) return res;
-        return min(pru_ram_size, size);
+        return len;
 }
 
 static ssize_t pru_read(struct rtdm_fd* fd, void __user* buf, size_t size) {
@@ -92,23 +169,26 @@ static ssize_t pru_write_rt(struct rtdm_fd* fd, const void __user* buf,
                             size_t size) {
         rtdm_printk(KERN_ALERT "PRU driver write called from RT context\n");
         struct pru_context* pctx = rtdm_fd_to_private(fd);
+        enum pru_ram_access_target target = READ_ONCE(pctx->ram_target);
+        if (!size) return 0;
 
-        size_t pru_ram_size = pru_to_ram_size(pctx);
-        void* pru_ram_ptr = pru_to_ram_ptr(pctx);
+        size_t len = min_t(size_t, pru_target_ram_size(target), size);
+        void* pru_ram_ptr = pru_target_ram_ptr(pctx, target);
 
-        void* kbuf = rtdm_malloc(pru_ram_size);
+        // Only the written prefix is staged, not the whole PRU RAM
+        void* kbuf = rtdm_malloc(len);
         if (!kbuf) return -ENOMEM;
-        int res = rtdm_copy_from_user(fd, kbuf, buf, min(size, pru_ram_size));
+        int res = rtdm_copy_from_user(fd, kbuf, buf, len);
 
         if (res) {
                 rtdm_free(kbuf);
                 return res;
         }
 
-        memcpy_toio(pru_ram_ptr, kbuf, min(size, pru_ram_size));
+        memcpy_toio(pru_ram_ptr, kbuf, len);
 
         rtdm_free(kbuf);
-        return min(size, pru_ram_size);
+        return len;
 }
 static ssize_t pru_write(struct rtdm_fd* fd, const void __user* buf,
                          size_t size) {
@@ -116,13 +196,35 @@ static ssize_t pru_write(struct rtdm_fd* fd, const void __user* buf,
         return 0;
 }
 
+static int pru_set_snapshot(struct rtdm_fd* fd, struct pru_context* pctx,
+                            void __user* arg) {
+        struct pru_snapshot_config cfg;
+        int res = rtdm_safe_copy_from_user(fd, &cfg, arg, sizeof(cfg));
+        if (res) return res;
+
+        if (cfg.length) {
+                if (cfg.target >= PRU_ACCESS_TARGET_COUNT) return -EINVAL;
+                if (!pru_snapshot_valid(&cfg, pru_target_ram_size(cfg.target)))
+                        return -EINVAL;
+        }
+
+        pctx->snapshot = cfg;
+        memset(&pctx->snapshot_stats, 0, sizeof(pctx->snapshot_stats));
+        return 0;
+}
+
 static int pru_ioctl_rt(struct rtdm_fd* fd, unsigned int request,
                         void __user* arg) {
         struct pru_context* pctx = rtdm_fd_to_private(fd);
-        if (request == PRU_ACCESS_IRAM || request == PRU_ACCESS_DRAM) {
+        if (request == PRU_ACCESS_IRAM || request == PRU_ACCESS_DRAM ||
+            request == PRU_ACCESS_SHRAM) {
                 pctx->ram_target = request;
                 return 0;
         }
+        if (request == PRU_SET_SNAPSHOT) return pru_set_snapshot(fd, pctx, arg);
+        if (request == PRU_GET_SNAPSHOT_STATS)
+                return rtdm_safe_copy_to_user(fd, arg, &pctx->snapshot_stats,
+                                              sizeof(pctx->snapshot_stats));
         printk(KERN_ERR "Invalid target for memory access: %i\n", request);
         return -EINVAL;
 }
@@ -132,8 +234,22 @@ static int pru_ioctl(struct rtdm_fd* fd, unsigned int request,
         return -EPERM;
 }
 
+/*
+ * Maps the RAM selected with ioctl into user space. The mapping always starts
+ * at the beginning of the RAM and stays valid after the target is switched.
+ */
 static int pru_mmap(struct rtdm_fd* fd, struct vm_area_struct* vma) {
-        return -EPERM;
+        struct pru_context* pctx = rtdm_fd_to_private(fd);
+        enum pru_ram_access_target target = READ_ONCE(pctx->ram_target);
+        size_t len = vma->vm_end - vma->vm_start;
+
+        if (vma->vm_pgoff || len > PAGE_ALIGN(pru_target_ram_size(target))) {
+                rtdm_printk(KERN_ERR "Invalid PRU RAM mapping: %zu bytes\n",
+                            len);
+                return -EINVAL;
+        }
+
+        return rtdm_mmap_iomem(vma, pru_target_ram_phys(target));
 }
 
 struct rtdm_driver pru_driver = {
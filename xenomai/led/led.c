@@ -5,6 +5,8 @@
 //#include <cobalt/kernel/thread.h>
 #include <rtdm/driver.h>
 
+#include "led_jitter.h"
+
 
 static const unsigned long LED_DATAOUT_REG = 0x4805113c;
 static const unsigned long LED_OE_REG = 0x48051134;
@@ -18,9 +20,12 @@ struct led_context {
     void* p_oe;
     rtdm_task_t led_task;
     rtdm_event_t event;
-    nanosecs_rel_t toggle_period;
     volatile int operate_thread;
-    volatile int led_figure;
+    // Protects toggle_period, led_figure and jitter
+    rtdm_lock_t lock;
+    nanosecs_rel_t toggle_period;
+    int led_figure;
+    struct led_jitter_hist jitter;
 };
 
 
@@ -29,19 +34,57 @@ static void led_thread(void* pargs){
     struct led_context* pctx = (struct led_context*)pargs;
     int event_wait_result = 0;
     int read_res = 0;
+    int figure;
+    nanosecs_abs_t next_deadline = rtdm_clock_read_monotonic();
+    nanosecs_abs_t now;
+    nanosecs_rel_t period;
+    nanosecs_rel_t timeout;
+    nanosecs_rel_t lateness;
+    s64 missed;
+    rtdm_lockctx_t lock_ctx;
 
     while(pctx->operate_thread){
+        rtdm_lock_get_irqsave(&pctx->lock, lock_ctx);
+        figure = pctx->led_figure;
+        period = pctx->toggle_period;
+        rtdm_lock_put_irqrestore(&pctx->lock, lock_ctx);
+
         read_res = ioread32(pctx->p_ctrl);
-        if(read_res != pctx->led_figure && read_res != ~pctx->led_figure)
-            read_res = pctx->led_figure;
+        if(read_res != figure && read_res != ~figure)
+            read_res = figure;
         iowrite32(~read_res, pctx->p_ctrl);
 
-        event_wait_result = rtdm_event_timedwait(&pctx->event, pctx->toggle_period, NULL);
+        // Edges are scheduled on an absolute grid, so the time spent in this
+        // loop does not accumulate as drift
+        next_deadline += period;
+        timeout = next_deadline - rtdm_clock_read_monotonic();
+        if(timeout > 0){
+            event_wait_result = rtdm_event_timedwait(&pctx->event, timeout, NULL);
+        } else {
+            // Already late, a zero timeout would wait forever
+            event_wait_result = -ETIMEDOUT;
+        }
         if(event_wait_result != 0 && event_wait_result != -ETIMEDOUT){
             break;
         }
 
+        // A pulse from write() restarts the grid from now, it is not a
+        // scheduled edge
+        if(event_wait_result == 0){
+            next_deadline = rtdm_clock_read_monotonic();
+            continue;
+        }
+
+        // Like hrtimer_forward(), skip the deadlines that already passed.
+        // Only those are missed edges.
+        now = rtdm_clock_read_monotonic();
+        lateness = now - next_deadline;
+        missed = lateness >= period ? div64_s64(lateness, period) : 0;
+        next_deadline += missed * period;
 
+        rtdm_lock_get_irqsave(&pctx->lock, lock_ctx);
+        led_jitter_record(&pctx->jitter, lateness, missed);
+        rtdm_lock_put_irqrestore(&pctx->lock, lock_ctx);
     }
 }
 
@@ -92,6 +135,8 @@ static int led_open(struct rtdm_fd* fd, int oflags){
     pctx->toggle_period = 1000000000;
     pctx->operate_thread = 1;
     pctx->led_figure = 0;
+    rtdm_lock_init(&pctx->lock);
+    led_jitter_reset(&pctx->jitter);
 
     if(rtdm_task_init(&pctx->led_task, "LED task", led_thread, pctx, RTDM_TASK_LOWEST_PRIORITY, 0)){
         release_mem_region(pctx->p_ctrl_region->start, 4);
@@ -140,28 +185,34 @@ static void led_close(struct rtdm_fd* fd){
     rtdm_printk(KERN_ALERT "led device closed\n");
 }
 
+// Returns the jitter histogram in the format shared with the non-RT driver
 static ssize_t led_read(struct rtdm_fd *fd, void __user *buf, size_t size){
-    int i=0;
-    static char kernel_buf[100];
-    rtdm_printk(KERN_ALERT "Driver read called}\n");
-    rtdm_printk(KERN_ALERT "Buffer size: %d\n", size);
+    struct led_context *pctx = rtdm_fd_to_private(fd);
+    struct led_jitter_hist hist;
+    rtdm_lockctx_t lock_ctx;
 
-    for(; i < size; i++){
-        kernel_buf[i] = i;
+    if(size < sizeof(hist)){
+        return -EINVAL;
     }
 
-    if(rtdm_copy_to_user(fd, buf, kernel_buf, min(100, size))){
+    rtdm_lock_get_irqsave(&pctx->lock, lock_ctx);
+    hist = pctx->jitter;
+    rtdm_lock_put_irqrestore(&pctx->lock, lock_ctx);
+
+    if(rtdm_copy_to_user(fd, buf, &hist, sizeof(hist))){
         rtdm_printk(KERN_ALERT "Failed to copy to user\n");
         return -EIO;
     }
-    return size;
+    return sizeof(hist);
 }
 
 static ssize_t led_write(struct rtdm_fd *fd, const void __user *buf, size_t size){
     struct led_context *pctx = rtdm_fd_to_private(fd);
+    rtdm_lockctx_t lock_ctx;
+    int check_result = 0;
 
-    if(size != 12){
-        return -EPERM;
+    if((check_result = led_check_pattern_size(size))){
+        return check_result;
     }
 
     uint32_t write_value = 0;
@@ -176,8 +227,14 @@ static ssize_t led_write(struct rtdm_fd *fd, const void __user *buf, size_t size
         return copy_result;
     }
 
+    if((check_result = led_check_period(toggle_period_ns))){
+        return check_result;
+    }
+
+    rtdm_lock_get_irqsave(&pctx->lock, lock_ctx);
     pctx->led_figure = write_value;
     pctx->toggle_period = toggle_period_ns;
+    rtdm_lock_put_irqrestore(&pctx->lock, lock_ctx);
 
     rtdm_event_pulse(&pctx->event);
 
@@ -185,6 +242,16 @@ static ssize_t led_write(struct rtdm_fd *fd, const void __user *buf, size_t size
 }
 
 static int led_ioctl(struct rtdm_fd *fd, unsigned int request, void __user *arg){
+    struct led_context *pctx = rtdm_fd_to_private(fd);
+    rtdm_lockctx_t lock_ctx;
+
+    if(request == LED_RESET_JITTER){
+        rtdm_lock_get_irqsave(&pctx->lock, lock_ctx);
+        led_jitter_reset(&pctx->jitter);
+        rtdm_lock_put_irqrestore(&pctx->lock, lock_ctx);
+        return 0;
+    }
+
     rtdm_printk(KERN_ALERT "Driver ioctl called\n");
     return EPERM;
 }